@@ -294,9 +294,9 @@ int main(int argc, char *argv[])
         }
 
         // Esperar para mantener 60 FPS
-        if (deltaTime < 1000 / 120)
+        if (deltaTime < 1000 / 60)
         {
-            SDL_Delay(1000 / 120 - deltaTime);
+            SDL_Delay(1000 / 60 - deltaTime);
         }
 
         if (currentTime - lastFPSTime >= 1000)
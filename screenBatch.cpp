@@ -0,0 +1,488 @@
+/**
+ *
+ * @author Pablo Gonzalez
+ * @author Javier Mombiela
+ * @author Jose Hernandez
+ *
+ * screenBatch.cpp: Simulacion por lotes de muchas escenas independientes sin ventana
+ *
+*/
+
+// Librerias utilizadas
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Valores por defecto de cada escena (los mismos de screenPar.cpp)
+const int DEFAULT_WIDTH = 1800;
+const int DEFAULT_HEIGHT = 1000;
+const int DEFAULT_RADIUS = 20;
+const int DEFAULT_MAX_SPEED = 5;
+const int MAX_CIRCLES = 1000000;
+
+// Escena guardada como estructura de arreglos: cada paso recorre x, y, dx y dy por separado
+struct Scene
+{
+    // Parametros
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    int radius = DEFAULT_RADIUS;
+    int maxSpeed = DEFAULT_MAX_SPEED;
+    int count = 0;
+    unsigned int seed = 0;
+
+    // Estado de los círculos
+    std::vector<int> x, y;   // Posicion de cada círculo
+    std::vector<int> dx, dy; // Velocidad de cada círculo
+
+    // Rejilla de la fase amplia: celdas de dos radios, círculos agrupados por la celda de su centro
+    int cellSize = 0, cols = 0, rows = 0;
+    std::vector<int> cellStart; // Inicio de cada celda en cellItems (cols * rows + 1 entradas)
+    std::vector<int> cellItems; // Índices de círculos agrupados por celda
+    std::vector<int> cellOf;    // Celda de cada círculo en este paso
+
+    // Estadisticas
+    uint64_t collisions = 0;
+    double seconds = 0.0;
+};
+
+std::vector<Scene> scenes;  // Escenas del lote
+int numThreads = 0;         // Hilos de OpenMP (--threads, 0 = todos)
+int steps = 1000;           // Pasos por escena (--steps)
+
+// Función para generar los círculos de una escena con su propia semilla. Cada escena tiene su
+// generador para que el resultado no dependa de que hilo la simule ni en que orden.
+void generateScene(Scene &scene)
+{
+    std::mt19937 generator(scene.seed);
+    scene.x.resize(scene.count);
+    scene.y.resize(scene.count);
+    scene.dx.resize(scene.count);
+    scene.dy.resize(scene.count);
+    for (int i = 0; i < scene.count; ++i)
+    {
+        scene.x[i] = generator() % (scene.width - scene.radius * 2) + scene.radius;
+        scene.y[i] = generator() % (scene.height - scene.radius * 2) + scene.radius;
+        scene.dx[i] = static_cast<int>(generator() % (scene.maxSpeed * 2 + 1)) - scene.maxSpeed;
+        scene.dy[i] = static_cast<int>(generator() % (scene.maxSpeed * 2 + 1)) - scene.maxSpeed;
+    }
+
+    scene.cellSize = 2 * scene.radius;
+    scene.cols = scene.width / scene.cellSize + 1;
+    scene.rows = scene.height / scene.cellSize + 1;
+    scene.cellStart.assign(static_cast<size_t>(scene.cols) * scene.rows + 1, 0);
+    scene.cellItems.resize(scene.count);
+    scene.cellOf.resize(scene.count);
+}
+
+// Función para agrupar los círculos por celda con un conteo (counting sort)
+void buildGrid(Scene &scene)
+{
+    std::fill(scene.cellStart.begin(), scene.cellStart.end(), 0);
+    for (int i = 0; i < scene.count; ++i)
+    {
+        int cx = std::clamp(scene.x[i] / scene.cellSize, 0, scene.cols - 1);
+        int cy = std::clamp(scene.y[i] / scene.cellSize, 0, scene.rows - 1);
+        scene.cellOf[i] = cy * scene.cols + cx;
+        scene.cellStart[scene.cellOf[i] + 1]++;
+    }
+    for (size_t c = 1; c < scene.cellStart.size(); ++c)
+    {
+        scene.cellStart[c] += scene.cellStart[c - 1];
+    }
+    std::vector<int> fill(scene.cellStart.begin(), scene.cellStart.end() - 1);
+    for (int i = 0; i < scene.count; ++i)
+    {
+        scene.cellItems[fill[scene.cellOf[i]]++] = i;
+    }
+}
+
+// Función para revisar y resolver la colisión entre dos círculos (misma respuesta que screenPar.cpp)
+void collidePair(Scene &scene, int i, int j)
+{
+    int dx = scene.x[i] - scene.x[j];
+    int dy = scene.y[i] - scene.y[j];
+    int distanceSquared = dx * dx + dy * dy;
+    if (distanceSquared > 4 * scene.radius * scene.radius)
+    {
+        return;
+    }
+    scene.collisions++;
+
+    // Invertir direcciones
+    scene.dx[i] = -scene.dx[i];
+    scene.dy[i] = -scene.dy[i];
+    scene.dx[j] = -scene.dx[j];
+    scene.dy[j] = -scene.dy[j];
+
+    // Separar los círculos a lo largo de la linea entre centros (dos centros iguales se separan en x)
+    float distance = std::sqrt(static_cast<float>(distanceSquared));
+    float overlap = 2 * scene.radius - distance;
+    float dxn = distanceSquared > 0 ? dx / distance : 1.0f;
+    float dyn = distanceSquared > 0 ? dy / distance : 0.0f;
+    scene.x[i] += (overlap / 2) * dxn;
+    scene.y[i] += (overlap / 2) * dyn;
+    scene.x[j] -= (overlap / 2) * dxn;
+    scene.y[j] -= (overlap / 2) * dyn;
+}
+
+// Función para avanzar una escena un paso: integrar, rebotar en las paredes y resolver colisiones
+void stepScene(Scene &scene)
+{
+    for (int i = 0; i < scene.count; ++i)
+    {
+        scene.x[i] += scene.dx[i];
+        scene.y[i] += scene.dy[i];
+    }
+    for (int i = 0; i < scene.count; ++i)
+    {
+        if (scene.x[i] <= scene.radius || scene.x[i] >= scene.width - scene.radius)
+        {
+            scene.dx[i] = -scene.dx[i]; // Cambio de dirección en el eje x
+        }
+        if (scene.y[i] <= scene.radius || scene.y[i] >= scene.height - scene.radius)
+        {
+            scene.dy[i] = -scene.dy[i]; // Cambio de dirección en el eje y
+        }
+    }
+
+    // Cada par se revisa una vez: desde el de menor indice, en su celda y las 8 vecinas
+    buildGrid(scene);
+    for (int i = 0; i < scene.count; ++i)
+    {
+        int cx = scene.cellOf[i] % scene.cols;
+        int cy = scene.cellOf[i] / scene.cols;
+        for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, scene.rows - 1); ++ny)
+        {
+            for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, scene.cols - 1); ++nx)
+            {
+                int cell = ny * scene.cols + nx;
+                for (int k = scene.cellStart[cell]; k < scene.cellStart[cell + 1]; ++k)
+                {
+                    int j = scene.cellItems[k];
+                    if (j > i)
+                    {
+                        collidePair(scene, i, j);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Función para calcular un checksum FNV-1a del estado final de una escena
+uint64_t sceneChecksum(const Scene &scene)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (const std::vector<int> *values : {&scene.x, &scene.y, &scene.dx, &scene.dy})
+    {
+        for (int value : *values)
+        {
+            hash = (hash ^ static_cast<uint32_t>(value)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// Función para calcular la energia cinetica media (dx^2 + dy^2) de una escena
+double meanKineticEnergy(const Scene &scene)
+{
+    double sum = 0.0;
+    for (int i = 0; i < scene.count; ++i)
+    {
+        sum += static_cast<double>(scene.dx[i]) * scene.dx[i] + static_cast<double>(scene.dy[i]) * scene.dy[i];
+    }
+    return scene.count > 0 ? sum / scene.count : 0.0;
+}
+
+// Función para quitar espacios al inicio y al final de un texto
+std::string trim(const std::string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+    {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+// Función para aplicar un ajuste "clave=valor" a una escena
+bool applySetting(Scene &scene, const std::string &key, int value)
+{
+    if (key == "count")
+    {
+        scene.count = value;
+    }
+    else if (key == "width")
+    {
+        scene.width = value;
+    }
+    else if (key == "height")
+    {
+        scene.height = value;
+    }
+    else if (key == "radius")
+    {
+        scene.radius = value;
+    }
+    else if (key == "max_speed")
+    {
+        scene.maxSpeed = value;
+    }
+    else if (key == "seed")
+    {
+        scene.seed = static_cast<unsigned int>(value);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Función para cargar una escena por linea: "count=500 radius=10 max_speed=8 seed=3".
+// Lo que no se indique toma el valor de la escena base; '#' inicia un comentario.
+bool loadSceneList(const std::string &path, const Scene &base)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Could not open scene list " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+        Scene scene = base;
+        scene.seed = base.seed + static_cast<unsigned int>(scenes.size());
+        std::istringstream fields(line);
+        std::string field;
+        while (fields >> field)
+        {
+            size_t equals = field.find('=');
+            if (equals == std::string::npos || !applySetting(scene, field.substr(0, equals), std::atoi(field.c_str() + equals + 1)))
+            {
+                std::cerr << path << ":" << lineNumber << ": invalid setting '" << field << "'" << std::endl;
+                return false;
+            }
+        }
+        scenes.push_back(scene);
+    }
+    return true;
+}
+
+// Función para validar los parametros de una escena
+bool validScene(const Scene &scene)
+{
+    return scene.count >= 1 && scene.count <= MAX_CIRCLES && scene.radius >= 1 && scene.maxSpeed >= 1 &&
+           scene.width > 4 * scene.radius && scene.height > 4 * scene.radius;
+}
+
+// Función para mostrar el uso del programa
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <numScenes> <circlesPerScene> [options]" << std::endl
+              << "       " << program << " --scene-list <file> [options]" << std::endl
+              << "  --steps <n>          Steps to simulate per scene (default 1000)" << std::endl
+              << "  --threads <n>        OpenMP threads (default: all)" << std::endl
+              << "  --seed <s>           Base seed; scene k uses s + k (default 1)" << std::endl
+              << "  --width <w>          World width of every scene (default 1800)" << std::endl
+              << "  --height <h>         World height of every scene (default 1000)" << std::endl
+              << "  --radius <r>         Circle radius (default 20)" << std::endl
+              << "  --speed <n>          Maximum speed per step (default 5)" << std::endl
+              << "  --scene-list <file>  One scene per line: count=, width=, height=, radius=, max_speed=, seed=" << std::endl
+              << "  --csv <file>         Write per-scene statistics as CSV" << std::endl;
+}
+
+// Función principal del programa
+int main(int argc, char *argv[])
+{
+    // Comprobar argumentos
+    if (argc < 2)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    int numScenes = 0;
+    Scene base;
+    base.seed = 1;
+    int firstOption = 1;
+    if (argc >= 3 && argv[1][0] != '-')
+    {
+        numScenes = std::atoi(argv[1]);
+        base.count = std::atoi(argv[2]);
+        firstOption = 3;
+    }
+    std::string sceneListPath;
+    std::string csvPath;
+    for (int i = firstOption; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (arg == "--steps")
+        {
+            steps = std::atoi(argv[++i]);
+        }
+        else if (arg == "--threads")
+        {
+            numThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--seed")
+        {
+            base.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--width")
+        {
+            base.width = std::atoi(argv[++i]);
+        }
+        else if (arg == "--height")
+        {
+            base.height = std::atoi(argv[++i]);
+        }
+        else if (arg == "--radius")
+        {
+            base.radius = std::atoi(argv[++i]);
+        }
+        else if (arg == "--speed")
+        {
+            base.maxSpeed = std::atoi(argv[++i]);
+        }
+        else if (arg == "--scene-list")
+        {
+            sceneListPath = argv[++i];
+        }
+        else if (arg == "--csv")
+        {
+            csvPath = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (numThreads <= 0)
+    {
+        numThreads = omp_get_max_threads();
+    }
+    if (steps < 1)
+    {
+        std::cerr << "Invalid number of steps" << std::endl;
+        return 1;
+    }
+
+    // Armar el lote: desde la lista de escenas o numScenes copias de la base con semillas distintas
+    if (!sceneListPath.empty())
+    {
+        if (!loadSceneList(sceneListPath, base))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        for (int k = 0; k < numScenes; ++k)
+        {
+            Scene scene = base;
+            scene.seed = base.seed + k;
+            scenes.push_back(scene);
+        }
+    }
+    if (scenes.empty())
+    {
+        std::cerr << "No scenes to simulate" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+    for (size_t k = 0; k < scenes.size(); ++k)
+    {
+        if (!validScene(scenes[k]))
+        {
+            std::cerr << "Scene " << k << " has invalid settings (count 1-" << MAX_CIRCLES
+                      << ", radius and speed at least 1, world larger than four radii)" << std::endl;
+            return 1;
+        }
+    }
+
+    // Cada escena la genera y simula completa un solo hilo: no hay sincronizacion entre pasos y
+    // los datos de la escena quedan en la memoria del hilo que la toco primero
+    double start = omp_get_wtime();
+    # pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1)
+    for (size_t k = 0; k < scenes.size(); ++k)
+    {
+        Scene &scene = scenes[k];
+        double sceneStart = omp_get_wtime();
+        generateScene(scene);
+        for (int step = 0; step < steps; ++step)
+        {
+            stepScene(scene);
+        }
+        scene.seconds = omp_get_wtime() - sceneStart;
+    }
+    double elapsed = omp_get_wtime() - start;
+
+    // Estadisticas por escena
+    std::ofstream csv;
+    if (!csvPath.empty())
+    {
+        csv.open(csvPath);
+        if (!csv)
+        {
+            std::cerr << "Could not write " << csvPath << std::endl;
+            return 1;
+        }
+        csv << "scene,circles,width,height,radius,max_speed,seed,steps,collisions,collisions_per_step,mean_kinetic_energy,seconds,circle_steps_per_second,checksum\n";
+    }
+    double circleSteps = 0.0, minSeconds = 1e30, maxSeconds = 0.0;
+    for (size_t k = 0; k < scenes.size(); ++k)
+    {
+        const Scene &scene = scenes[k];
+        double sceneSteps = static_cast<double>(scene.count) * steps;
+        circleSteps += sceneSteps;
+        minSeconds = std::min(minSeconds, scene.seconds);
+        maxSeconds = std::max(maxSeconds, scene.seconds);
+
+        char checksum[17];
+        std::snprintf(checksum, sizeof(checksum), "%016llx", static_cast<unsigned long long>(sceneChecksum(scene)));
+        std::cout << "Scene " << k << ": " << scene.count << " circles, r " << scene.radius << ", speed " << scene.maxSpeed
+                  << ", seed " << scene.seed << " | collisions/step: " << static_cast<double>(scene.collisions) / steps
+                  << " | mean KE: " << meanKineticEnergy(scene) << " | " << scene.seconds * 1000.0 << " ms"
+                  << " | checksum " << checksum << std::endl;
+        if (csv)
+        {
+            csv << k << "," << scene.count << "," << scene.width << "," << scene.height << "," << scene.radius << ","
+                << scene.maxSpeed << "," << scene.seed << "," << steps << "," << scene.collisions << ","
+                << static_cast<double>(scene.collisions) / steps << "," << meanKineticEnergy(scene) << ","
+                << scene.seconds << "," << sceneSteps / scene.seconds << "," << checksum << "\n";
+        }
+    }
+
+    // Resumen del lote
+    std::cout << "Batch: " << scenes.size() << " scenes x " << steps << " steps on " << numThreads << " threads | time: "
+              << elapsed << " s | scene time: " << minSeconds * 1000.0 << "-" << maxSeconds * 1000.0 << " ms"
+              << " | circle-steps/s: " << circleSteps / elapsed << std::endl;
+    return 0;
+}
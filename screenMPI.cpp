@@ -0,0 +1,511 @@
+/**
+ *
+ * @author Pablo Gonzalez
+ * @author Javier Mombiela
+ * @author Jose Hernandez
+ *
+ * screenMPI.cpp: Version distribuida con MPI (descomposicion del mundo en franjas)
+ *
+*/
+
+// Librerias utilizadas
+#include <SDL2/SDL.h>
+#include <mpi.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <ctime>
+#include <cmath>
+#include <algorithm>
+
+// Constantes de tamaño y ajustes del programa
+const int SCREEN_WIDTH = 1800;
+const int SCREEN_HEIGHT = 1000;
+const int MAX_CIRCLES = 200000;
+const int CIRCLE_RADIUS = 20;
+const int MAX_SPEED = 5;
+
+// Definición de la estructura Circle
+struct Circle
+{
+    int x, y;        // Coordenadas del centro del círculo
+    int dx, dy;      // Velocidad del círculo en cada eje
+    SDL_Color color; // Color del círculo
+};
+
+SDL_Window *window = nullptr;     // Puntero a la ventana (solo rank 0)
+SDL_Renderer *renderer = nullptr; // Puntero al renderer (solo rank 0)
+std::vector<Circle> circles;      // Círculos propios de este rank
+std::vector<Circle> halo;         // Copias de los círculos vecinos cerca de los bordes de la franja
+std::vector<Circle> allCircles;   // Todos los círculos reunidos en rank 0 para dibujar
+bool quit = false;                // Variable para controlar el bucle principal
+
+int rank = 0;                     // Rank de este proceso
+int numRanks = 1;                 // Cantidad de procesos
+int slabTop = 0;                  // Primera fila (inclusive) de la franja de este rank
+int slabBottom = SCREEN_HEIGHT;   // Ultima fila (exclusive) de la franja de este rank
+MPI_Datatype circleType;          // Tipo MPI para enviar Circle como bloque de bytes
+
+// Función para inicializar SDL (solo en rank 0)
+bool init()
+{
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    // Crear ventana y renderer
+
+    window = SDL_CreateWindow("ScreensaverMPI", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+    if (window == nullptr)
+    {
+        std::cerr << "Window could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (renderer == nullptr)
+    {
+        std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Función para cerrar SDL
+void close()
+{
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+// Función para calcular la franja horizontal que le toca a un rank
+void slabBounds(int r, int &top, int &bottom)
+{
+    top = static_cast<int>(static_cast<long long>(SCREEN_HEIGHT) * r / numRanks);
+    bottom = static_cast<int>(static_cast<long long>(SCREEN_HEIGHT) * (r + 1) / numRanks);
+}
+
+// Función para saber a que rank pertenece una fila del mundo
+int ownerOf(int y)
+{
+    int r = static_cast<int>(static_cast<long long>(std::clamp(y, 0, SCREEN_HEIGHT - 1)) * numRanks / SCREEN_HEIGHT);
+    // Corregir por redondeo en los limites de la franja
+    int top, bottom;
+    slabBounds(r, top, bottom);
+    if (y < top && r > 0)
+    {
+        --r;
+    }
+    else if (y >= bottom && r < numRanks - 1)
+    {
+        ++r;
+    }
+    return r;
+}
+
+// Función para generar círculos aleatorios: cada rank genera solo los que caen en su franja
+void generateRandomCircles(int numCircles)
+{
+    circles.clear();
+    // Misma semilla en todos los ranks para que la escena global sea la misma sin importar N
+    std::srand(12345);
+    for (int i = 0; i < numCircles; ++i)
+    {
+        Circle circle;
+        circle.x = std::rand() % (SCREEN_WIDTH - CIRCLE_RADIUS * 2) + CIRCLE_RADIUS;
+        circle.y = std::rand() % (SCREEN_HEIGHT - CIRCLE_RADIUS * 2) + CIRCLE_RADIUS;
+        circle.dx = std::rand() % (MAX_SPEED * 2 + 1) - MAX_SPEED;
+        circle.dy = std::rand() % (MAX_SPEED * 2 + 1) - MAX_SPEED;
+        circle.color = {static_cast<Uint8>(std::rand() % 256), static_cast<Uint8>(std::rand() % 256), static_cast<Uint8>(std::rand() % 256)};
+
+        if (ownerOf(circle.y) == rank)
+        {
+            circles.push_back(circle);
+        }
+    }
+}
+
+// Función para intercambiar listas de círculos con los ranks vecinos (arriba y abajo)
+void exchangeWithNeighbors(const std::vector<Circle> &toUp, const std::vector<Circle> &toDown,
+                           std::vector<Circle> &fromUp, std::vector<Circle> &fromDown)
+{
+    int up = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+    int down = rank < numRanks - 1 ? rank + 1 : MPI_PROC_NULL;
+
+    // Primero se intercambian los tamaños y despues los datos
+    int sendUp = static_cast<int>(toUp.size());
+    int sendDown = static_cast<int>(toDown.size());
+    int recvUp = 0;
+    int recvDown = 0;
+    MPI_Sendrecv(&sendUp, 1, MPI_INT, up, 0, &recvDown, 1, MPI_INT, down, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(&sendDown, 1, MPI_INT, down, 1, &recvUp, 1, MPI_INT, up, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    fromUp.resize(recvUp);
+    fromDown.resize(recvDown);
+    MPI_Sendrecv(toUp.data(), sendUp, circleType, up, 2, fromDown.data(), recvDown, circleType, down, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(toDown.data(), sendDown, circleType, down, 3, fromUp.data(), recvUp, circleType, up, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+// Función para enviar a los vecinos los círculos cercanos al borde de la franja (halo)
+void exchangeHalo()
+{
+    std::vector<Circle> toUp, toDown, fromUp, fromDown;
+    for (const Circle &circle : circles)
+    {
+        if (circle.y < slabTop + 2 * CIRCLE_RADIUS)
+        {
+            toUp.push_back(circle);
+        }
+        if (circle.y >= slabBottom - 2 * CIRCLE_RADIUS)
+        {
+            toDown.push_back(circle);
+        }
+    }
+    exchangeWithNeighbors(toUp, toDown, fromUp, fromDown);
+    halo.clear();
+    halo.insert(halo.end(), fromUp.begin(), fromUp.end());
+    halo.insert(halo.end(), fromDown.begin(), fromDown.end());
+}
+
+// Función para pasar al rank vecino los círculos que cruzaron el borde de la franja
+void migrateCircles()
+{
+    std::vector<Circle> toUp, toDown, fromUp, fromDown;
+    size_t kept = 0;
+    for (size_t i = 0; i < circles.size(); ++i)
+    {
+        const Circle &circle = circles[i];
+        if (circle.y < slabTop && rank > 0)
+        {
+            toUp.push_back(circle);
+        }
+        else if (circle.y >= slabBottom && rank < numRanks - 1)
+        {
+            toDown.push_back(circle);
+        }
+        else
+        {
+            circles[kept++] = circle;
+        }
+    }
+    circles.resize(kept);
+    exchangeWithNeighbors(toUp, toDown, fromUp, fromDown);
+    circles.insert(circles.end(), fromUp.begin(), fromUp.end());
+    circles.insert(circles.end(), fromDown.begin(), fromDown.end());
+}
+
+// Función para mover los círculos propios (se cambia la velocidad cuando tocan el borde)
+void moveCircles()
+{
+    for (size_t i = 0; i < circles.size(); ++i)
+    {
+        Circle &circle = circles[i];
+        circle.x += circle.dx;
+        circle.y += circle.dy;
+
+        if (circle.x <= CIRCLE_RADIUS || circle.x >= SCREEN_WIDTH - CIRCLE_RADIUS)
+        {
+            circle.dx = -circle.dx; // Cambio de dirección en el eje x
+        }
+
+        if (circle.y <= CIRCLE_RADIUS || circle.y >= SCREEN_HEIGHT - CIRCLE_RADIUS)
+        {
+            circle.dy = -circle.dy; // Cambio de dirección en el eje y
+        }
+    }
+
+    // Los vecinos necesitan las posiciones ya integradas para revisar colisiones en el borde
+    exchangeHalo();
+
+    // Verificar colisiones: se ordena por x y solo se revisan pares con |dx| <= 2 * radio.
+    // Los índices >= circles.size() son copias del halo y no se modifican aquí; su dueño
+    // aplica la mitad simetrica de la respuesta.
+    size_t numOwned = circles.size();
+    std::vector<Circle> local(circles);
+    local.insert(local.end(), halo.begin(), halo.end());
+    std::vector<int> order(local.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = static_cast<int>(i);
+    }
+    std::sort(order.begin(), order.end(), [&local](int a, int b)
+              { return local[a].x < local[b].x; });
+
+    for (size_t a = 0; a < order.size(); ++a)
+    {
+        for (size_t b = a + 1; b < order.size(); ++b)
+        {
+            size_t i = order[a];
+            size_t j = order[b];
+            if (local[j].x - local[i].x > 2 * CIRCLE_RADIUS)
+            {
+                break;
+            }
+            bool ownI = i < numOwned;
+            bool ownJ = j < numOwned;
+            if (!ownI && !ownJ)
+            {
+                continue;
+            }
+            int dx = local[i].x - local[j].x;
+            int dy = local[i].y - local[j].y;
+            int distanceSquared = dx * dx + dy * dy;
+
+            if (distanceSquared <= 4 * CIRCLE_RADIUS * CIRCLE_RADIUS) // 2 * radio porque estamos comparando centros
+            {
+                // Calcular la distancia real y el desplazamiento necesario para corregir la colisión
+                float distance = std::max(1.0f, std::sqrt(static_cast<float>(distanceSquared)));
+                float overlap = 2 * CIRCLE_RADIUS - distance;
+                float dxn = dx / distance;
+                float dyn = dy / distance;
+
+                // Invertir direcciones y mover fuera de la colisión solo los círculos propios
+                if (ownI)
+                {
+                    local[i].dx = -local[i].dx;
+                    local[i].dy = -local[i].dy;
+                    local[i].x += (overlap / 2) * dxn;
+                    local[i].y += (overlap / 2) * dyn;
+                }
+                if (ownJ)
+                {
+                    local[j].dx = -local[j].dx;
+                    local[j].dy = -local[j].dy;
+                    local[j].x -= (overlap / 2) * dxn;
+                    local[j].y -= (overlap / 2) * dyn;
+                }
+            }
+        }
+    }
+    std::copy(local.begin(), local.begin() + numOwned, circles.begin());
+
+    migrateCircles();
+}
+
+// Función para reunir todos los círculos en rank 0
+void gatherCircles()
+{
+    int count = static_cast<int>(circles.size());
+    std::vector<int> counts(numRanks), offsets(numRanks);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        int total = 0;
+        for (int r = 0; r < numRanks; ++r)
+        {
+            offsets[r] = total;
+            total += counts[r];
+        }
+        allCircles.resize(total);
+    }
+    MPI_Gatherv(circles.data(), count, circleType, allCircles.data(), counts.data(), offsets.data(), circleType, 0, MPI_COMM_WORLD);
+}
+
+// Función para dibujar un círculo relleno
+void drawFilledCircle(SDL_Renderer *renderer, int centerX, int centerY, int radius, const SDL_Color &color)
+{
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+
+    // Llenar el círculo con puntos dentro del radio
+    for (int y = -radius; y <= radius; ++y)
+    {
+        for (int x = -radius; x <= radius; ++x)
+        {
+            if (x * x + y * y <= radius * radius)
+            {
+                SDL_RenderDrawPoint(renderer, centerX + x, centerY + y);
+            }
+        }
+    }
+}
+
+// Función para renderizar la escena (solo rank 0)
+void render()
+{
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+
+    // Dibujar los círculos con la función drawFilledCircle
+    for (const Circle &circle : allCircles)
+    {
+        drawFilledCircle(renderer, circle.x + CIRCLE_RADIUS, circle.y + CIRCLE_RADIUS, CIRCLE_RADIUS, circle.color);
+    }
+
+    SDL_RenderPresent(renderer);
+}
+
+// Función para medir la simulacion sin ventana: reporta pasos por segundo y desbalance entre ranks
+void runBenchmark(int steps)
+{
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    for (int step = 0; step < steps; ++step)
+    {
+        moveCircles();
+    }
+    double elapsed = MPI_Wtime() - start;
+
+    double maxElapsed = 0.0;
+    long long localCount = static_cast<long long>(circles.size());
+    long long minCount = 0, maxCount = 0, totalCount = 0;
+    MPI_Reduce(&elapsed, &maxElapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&localCount, &minCount, 1, MPI_LONG_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&localCount, &maxCount, 1, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&localCount, &totalCount, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        std::cout << "Ranks: " << numRanks << " | circles: " << totalCount << " | steps: " << steps
+                  << " | time: " << maxElapsed << " s | steps/s: " << steps / maxElapsed
+                  << " | circles per rank: " << minCount << "-" << maxCount << std::endl;
+    }
+}
+
+// Función principal del programa
+int main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+    MPI_Type_contiguous(sizeof(Circle), MPI_BYTE, &circleType);
+    MPI_Type_commit(&circleType);
+    slabBounds(rank, slabTop, slabBottom);
+
+    // Comprobar argumentos
+    if (argc < 2)
+    {
+        if (rank == 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " <numCircles> [--bench <steps>]" << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    // Comprobar que el número de círculos es válido
+    int numCircles = std::atoi(argv[1]);
+    int benchSteps = 0;
+    if (argc >= 4 && std::string(argv[2]) == "--bench")
+    {
+        benchSteps = std::atoi(argv[3]);
+    }
+    if (numCircles < 1 || numCircles > MAX_CIRCLES)
+    {
+        if (rank == 0)
+        {
+            std::cerr << "Invalid number of circles. Please use a value between 1 and " << MAX_CIRCLES << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    // Cada franja debe ser mas alta que el halo y que el desplazamiento maximo por paso
+    if (SCREEN_HEIGHT / numRanks < 2 * CIRCLE_RADIUS + MAX_SPEED)
+    {
+        if (rank == 0)
+        {
+            std::cerr << "Too many ranks for a world of height " << SCREEN_HEIGHT << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    // Generar círculos aleatorios
+    generateRandomCircles(numCircles);
+
+    if (benchSteps > 0)
+    {
+        runBenchmark(benchSteps);
+        MPI_Type_free(&circleType);
+        MPI_Finalize();
+        return 0;
+    }
+
+    int initOk = 1;
+    if (rank == 0 && !init())
+    {
+        initOk = 0;
+    }
+    MPI_Bcast(&initOk, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!initOk)
+    {
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Variables para medir el tiempo
+    Uint32 startTime = SDL_GetTicks();
+    Uint32 prevTime = startTime;
+    Uint32 totalTime = 0;
+    int frames = 0;
+    int totalFrames = 0;
+
+    // Bucle principal
+    while (!quit)
+    {
+        // Calcular el tiempo transcurrido y gestionar eventos SDL (solo rank 0)
+        Uint32 currentTime = SDL_GetTicks();
+        Uint32 deltaTime = currentTime - prevTime;
+        prevTime = currentTime;
+
+        int quitFlag = 0;
+        if (rank == 0)
+        {
+            SDL_Event e;
+            while (SDL_PollEvent(&e) != 0)
+            {
+                if (e.type == SDL_QUIT)
+                {
+                    quitFlag = 1;
+                }
+            }
+        }
+        MPI_Bcast(&quitFlag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        quit = quitFlag != 0;
+
+        // Mover en todos los ranks, reunir y renderizar en rank 0
+        moveCircles();
+        gatherCircles();
+        if (rank == 0)
+        {
+            render();
+
+            // Calcular y mostrar FPS
+            frames++;
+            totalFrames++;
+            totalTime += deltaTime;
+            if (currentTime - startTime >= 1000)
+            {
+                std::cout << "FPS: " << frames << std::endl;
+                startTime = currentTime;
+                frames = 0;
+            }
+
+            // Esperar para mantener 60 FPS
+            if (deltaTime < 1000 / 60)
+            {
+                SDL_Delay(1000 / 60 - deltaTime);
+            }
+        }
+    }
+
+    if (rank == 0)
+    {
+        if (totalTime > 0)
+        {
+            float avgFPS = 1000.0f * totalFrames / totalTime;
+            std::cout << "Average FPS: " << avgFPS << std::endl;
+        }
+        else
+        {
+            std::cout << "No frames were rendered." << std::endl;
+        }
+        // Cerrar SDL
+        close();
+    }
+
+    MPI_Type_free(&circleType);
+    MPI_Finalize();
+    // Salir del programa
+    return 0;
+}